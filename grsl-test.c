@@ -25,6 +25,9 @@
 #include <stdio.h>
 #include <time.h>
 #include <config.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_randist.h>
 #include <gsl/gsl_sampling.h>
@@ -89,11 +92,325 @@ void grsl_test_aggregate(const gsl_sampler *s, const gsl_rng *r, size_t n, size_
   free(record_count);
 }
 
+void grsl_test_unordered(const gsl_sampler *s, const gsl_rng *r, size_t n, size_t N,
+                         size_t repeats)
+{
+  size_t i, j;
+  size_t *src, *dest, *first_count;
+
+  src = malloc(N*sizeof(size_t));
+  dest = malloc(n*sizeof(size_t));
+  first_count = malloc(N*sizeof(size_t));
+
+  for(i=0;i<N;++i)
+    {
+      src[i] = i;
+      first_count[i] = 0;
+    }
+
+  printf("%s, %zu from %zu x %zu, in random order:\n",s->algorithm->name, n, N, repeats);
+
+  for(i=0;i<repeats;++i)
+    {
+      gsl_sampler_choose_unordered(s, r, dest, n, src, N, sizeof(size_t));
+      first_count[dest[0]]++;
+    }
+
+  printf("\tlast sample:");
+  for(j=0;j<n;++j)
+    printf(" %zu",dest[j]+1);
+  printf("\n");
+
+  for(i=0;i<N;++i)
+    printf("\trecord %zu came first %zu times.\n",i+1,first_count[i]);
+
+  free(first_count);
+  free(dest);
+  free(src);
+}
+
+void grsl_test_multi(const gsl_sampler * const *s, size_t R, const gsl_rng *r,
+                     size_t n, size_t N)
+{
+  size_t i;
+  double *src, **dest;
+  clock_t start_time, end_time;
+
+  src = malloc(N*sizeof(*src));
+  dest = malloc(R*sizeof(*dest));
+
+  for(i=0;i<N;++i)
+    src[i] = i+1;
+
+  for(i=0;i<R;++i)
+    dest[i] = malloc(n*sizeof(**dest));
+
+  printf("%zu samples of %zu from %zu with %s:\n", R, n, N, s[0]->algorithm->name);
+
+  start_time = clock();
+  for(i=0;i<R;++i)
+    gsl_sampler_choose(s[i], r, dest[i], n, src, N, sizeof(double));
+  end_time = clock();
+
+  printf("\t%zu calls to gsl_sampler_choose finished in %g seconds.\n", R,
+         ((double) (end_time-start_time))/CLOCKS_PER_SEC);
+
+  start_time = clock();
+  gsl_sampler_choose_multi(s, R, r, (void **) dest, n, src, N, sizeof(double));
+  end_time = clock();
+
+  printf("\tgsl_sampler_choose_multi finished in %g seconds.\n",
+         ((double) (end_time-start_time))/CLOCKS_PER_SEC);
+
+  for(i=0;i<R;++i)
+    printf("\tsample %zu starts with records %g, %g, %g.\n",
+           i+1, dest[i][0], dest[i][1], dest[i][2]);
+
+  for(i=0;i<R;++i)
+    free(dest[i]);
+  free(dest);
+  free(src);
+}
+
+void grsl_test_bernoulli(gsl_bernoulli_sampler *b, const gsl_rng *r, double p,
+                        size_t N)
+{
+  size_t i, k;
+  double *src, *dest;
+  clock_t start_time, end_time;
+
+  src = malloc(N*sizeof(*src));
+  dest = malloc(N*sizeof(*dest));
+
+  for(i=0;i<N;++i)
+    src[i] = i+1;
+
+  gsl_bernoulli_sampler_init(b, p, N);
+
+  printf("Bernoulli sample with p = %g from %zu:\n", b->p, N);
+
+  start_time = clock();
+  for(i=0, k=0;i<N;++i)
+    {
+      if (gsl_rng_uniform(r) < p)
+        dest[k++] = src[i];
+    }
+  end_time = clock();
+
+  printf("\tone variate per record: %zu selected in %g seconds.\n", k,
+         ((double) (end_time-start_time))/CLOCKS_PER_SEC);
+
+  start_time = clock();
+  gsl_bernoulli_sampler_choose(b, r, dest, N, &k, src, N, sizeof(double));
+  end_time = clock();
+
+  printf("\tgsl_bernoulli_sampler_choose: %zu selected in %g seconds.\n", k,
+         ((double) (end_time-start_time))/CLOCKS_PER_SEC);
+
+  free(dest);
+  free(src);
+}
+
+/* Which thread record j belongs to.  The stream is dealt out in blocks
+   in which thread t gets (threads - t) consecutive records, so with 4
+   threads they see uneven, interleaved shares of 40%, 30%, 20% and 10%
+   of the stream. */
+static size_t
+grsl_test_reservoir_owner(size_t j, size_t threads)
+{
+  size_t t = 0, share = threads;
+
+  j %= threads * (threads + 1) / 2;
+
+  while (j >= share)
+    {
+      j -= share--;
+      ++t;
+    }
+
+  return t;
+}
+
+typedef struct
+  {
+    const gsl_reservoir_sampler *s;
+    const gsl_rng *r;
+    size_t thread;
+    size_t N;
+  }
+grsl_test_reservoir_feed_t;
+
+/* Pushes, on behalf of one thread, every record of the stream that
+   belongs to that thread. */
+static void *
+grsl_test_reservoir_feed(void *vfeed)
+{
+  const grsl_test_reservoir_feed_t *feed = vfeed;
+  size_t j;
+
+  for(j=0;j<feed->N;++j)
+    {
+      if (grsl_test_reservoir_owner(j, feed->s->threads) == feed->thread)
+        gsl_reservoir_sampler_push(feed->s, feed->thread, feed->r, &j);
+    }
+
+  return NULL;
+}
+
+/* Where configure found POSIX threads, each thread's share of the stream
+   is pushed from a real thread of its own, so that pushes (and publishing
+   the shared threshold) genuinely overlap.  Otherwise a single thread
+   feeds each share in turn.  Either way N is much larger than k times the
+   number of threads, so the reservoirs fill up early and most records are
+   skipped against the shared threshold. */
+void grsl_test_reservoir(gsl_reservoir_sampler *s, gsl_rng * const *r,
+                         size_t N, size_t repeats)
+{
+  size_t i, j, k, t;
+  size_t *dest, *thread_count, *thread_share, bucket_count[10];
+  grsl_test_reservoir_feed_t *feed;
+#ifdef HAVE_PTHREAD
+  pthread_t *thread;
+#endif
+
+  dest = malloc(s->k*sizeof(size_t));
+  thread_count = malloc(s->threads*sizeof(size_t));
+  thread_share = malloc(s->threads*sizeof(size_t));
+  feed = malloc(s->threads*sizeof(grsl_test_reservoir_feed_t));
+#ifdef HAVE_PTHREAD
+  thread = malloc(s->threads*sizeof(pthread_t));
+#endif
+
+  for(i=0;i<10;++i)
+    bucket_count[i] = 0;
+
+  for(t=0;t<s->threads;++t)
+    {
+      thread_count[t] = thread_share[t] = 0;
+      feed[t].s = s;
+      feed[t].r = r[t];
+      feed[t].thread = t;
+      feed[t].N = N;
+    }
+
+  for(j=0;j<N;++j)
+    thread_share[grsl_test_reservoir_owner(j, s->threads)]++;
+
+#ifdef HAVE_PTHREAD
+  printf("reservoir, %zu from %zu fed by %zu threads x %zu:\n",
+         s->k, N, s->threads, repeats);
+#else
+  printf("reservoir, %zu from %zu fed by %zu simulated threads x %zu:\n",
+         s->k, N, s->threads, repeats);
+#endif
+
+  for(i=0;i<repeats;++i)
+    {
+      gsl_reservoir_sampler_init(s);
+
+#ifdef HAVE_PTHREAD
+      for(t=0;t<s->threads;++t)
+        pthread_create(&thread[t], NULL, &grsl_test_reservoir_feed, &feed[t]);
+
+      for(t=0;t<s->threads;++t)
+        pthread_join(thread[t], NULL);
+#else
+      for(t=0;t<s->threads;++t)
+        grsl_test_reservoir_feed(&feed[t]);
+#endif
+
+      k = gsl_reservoir_sampler_gather(s, dest);
+
+      for(j=0;j<k;++j)
+        {
+          bucket_count[dest[j] * 10 / N]++;
+          thread_count[grsl_test_reservoir_owner(dest[j], s->threads)]++;
+        }
+    }
+
+  for(i=0;i<10;++i)
+    printf("\trecords %zu-%zu were picked %zu times (expected %g).\n",
+           i*N/10 + 1, (i+1)*N/10, bucket_count[i],
+           ((double) s->k * repeats) / 10);
+
+  for(t=0;t<s->threads;++t)
+    printf("\tthread %zu's %zu records were picked %zu times (expected %g).\n",
+           t, thread_share[t], thread_count[t],
+           ((double) s->k * repeats * thread_share[t]) / N);
+
+#ifdef HAVE_PTHREAD
+  free(thread);
+#endif
+  free(feed);
+  free(thread_share);
+  free(thread_count);
+  free(dest);
+}
+
+void grsl_test_backing(gsl_backing_sample *b, const gsl_sampler *s,
+                       const gsl_rng *r, size_t N, size_t operations)
+{
+  size_t i, j, n, next_key, refreshes = 0;
+  size_t *keys;
+  clock_t start_time, end_time;
+
+  keys = malloc(2*N*sizeof(size_t));
+
+  for(n=0;n<N;++n)
+    keys[n] = n;
+  next_key = N;
+
+  printf("backing sample of %zu-%zu from %zu, %zu inserts and deletes:\n",
+         b->min_size, b->max_size, N, operations);
+
+  start_time = clock();
+
+  gsl_backing_sample_init(b, s, r, keys, n);
+
+  for(i=0;i<operations;++i)
+    {
+      /* Slightly more deletes than inserts, so the table shrinks and the
+         sample now and then needs refreshing. */
+      if (n < 2*N && gsl_rng_uniform(r) < 0.45)
+        {
+          keys[n++] = next_key;
+          gsl_backing_sample_insert(b, r, next_key++);
+        }
+      else if (n > 0)
+        {
+          j = gsl_rng_uniform_int(r, n);
+          gsl_backing_sample_delete(b, keys[j]);
+          keys[j] = keys[--n];
+        }
+
+      if (gsl_backing_sample_needs_refresh(b))
+        {
+          gsl_backing_sample_refresh(b, s, r, keys, n);
+          ++refreshes;
+        }
+    }
+
+  end_time = clock();
+
+  printf("\tfinished in %g seconds with %s, %zu refreshes.\n",
+         ((double) (end_time-start_time))/CLOCKS_PER_SEC, s->algorithm->name,
+         refreshes);
+  printf("\ttable now holds %zu records, sample holds %zu.\n",
+         b->population, b->size);
+
+  free(keys);
+}
+
 int main(int argc, char *argv[])
 {
   size_t i;
   gsl_sampler *s = gsl_sampler_alloc(gsl_sampler_vitter_a);
   gsl_sampler *sd = gsl_sampler_alloc(gsl_sampler_vitter_d);
+  gsl_sampler *smulti[8];
+  gsl_bernoulli_sampler *sb = gsl_bernoulli_sampler_alloc();
+  gsl_reservoir_sampler *sr = gsl_reservoir_sampler_alloc(20, sizeof(size_t), 4);
+  gsl_rng *rthreads[4];
+  gsl_backing_sample *sbacking = gsl_backing_sample_alloc(1000, 500);
   gsl_rng *r = gsl_rng_alloc(gsl_rng_mt19937);
   double *dest, *src;
   time_t ranseed;
@@ -169,8 +486,65 @@ int main(int argc, char *argv[])
   free(dest);
   free(src);
 
+  printf("\n");
+  printf("gsl_sampler_choose always returns records in the order they appear\n");
+  printf("in the source array.  gsl_sampler_choose_unordered instead returns\n");
+  printf("them in random order, without needing a separate shuffle.  Here we\n");
+  printf("pick 5 records out of 10, 1 million times, and count how often each\n");
+  printf("record comes out first.\n\n");
+
+  grsl_test_unordered(sd, r, 5, 10, 1000000);
+
+  printf("\n");
+  printf("Next, gsl_sampler_choose_multi draws several independent\n");
+  printf("samples from the same array in a single pass.  We compare it with\n");
+  printf("drawing 8 samples of 100,000 from 10 million one at a time.\n\n");
+
+  for(i=0;i<8;++i)
+    smulti[i] = gsl_sampler_alloc(gsl_sampler_vitter_d);
+
+  grsl_test_multi((const gsl_sampler * const *) smulti, 8, r, 100000, 10000000);
+
+  for(i=0;i<8;++i)
+    gsl_sampler_free(smulti[i]);
+
+  printf("\n");
+  printf("GrSL can also take Bernoulli samples, where each\n");
+  printf("record is picked independently with a fixed probability.  Instead\n");
+  printf("of one random variate per record, it generates the gaps between\n");
+  printf("picked records directly.\n\n");
+
+  grsl_test_bernoulli(sb, r, 0.01, 10000000);
+
+  printf("\n");
+  printf("The reservoir sampler takes a uniform sample from a\n");
+  printf("stream of records that is split between several threads.  Here 4\n");
+  printf("threads get uneven shares of a stream of 4000 records, and we take\n");
+  printf("a sample of 20 from it 20,000 times.\n\n");
+
+  for(i=0;i<4;++i)
+    {
+      rthreads[i] = gsl_rng_alloc(gsl_rng_mt19937);
+      gsl_rng_set(rthreads[i], ranseed + i + 1);
+    }
+
+  grsl_test_reservoir(sr, rthreads, 4000, 20000);
+
+  for(i=0;i<4;++i)
+    gsl_rng_free(rthreads[i]);
+
+  printf("\n");
+  printf("Finally for now, a backing sample keeps a uniform sample of a table\n");
+  printf("up to date as records are inserted and deleted, only re-sampling\n");
+  printf("from the whole table when the sample risks getting too small.\n\n");
+
+  grsl_test_backing(sbacking, sd, r, 1000000, 1000000);
+
   gsl_sampler_free(s);
   gsl_sampler_free(sd);
+  gsl_bernoulli_sampler_free(sb);
+  gsl_reservoir_sampler_free(sr);
+  gsl_backing_sample_free(sbacking);
   gsl_rng_free(r);
 
   return EXIT_SUCCESS;
@@ -0,0 +1,379 @@
+/* sampling/backing.c
+ *
+ * ---------------------------------------------------------------------
+ * Provides a backing sample: a uniform random sample of a table of
+ * records that is maintained as records are inserted into and deleted
+ * from the table, in the sense of Gibbons, Matias & Poosala (1997).
+ *
+ * Inserts and deletes are handled by the random pairing scheme of
+ * Gemulla, Lehner & Haas (2006), which keeps the sample uniform at
+ * every step in O(1) expected time per operation:
+ *
+ *   Gibbons PB, Matias Y, Poosala V (1997) 'Fast incremental
+ *     maintenance of approximate histograms.'  Proc. 23rd VLDB
+ *     Conference: 466--475.
+ *
+ *   Gemulla R, Lehner W, Haas PJ (2006) 'A dip in the reservoir:
+ *     maintaining sample synopses of evolving datasets.'  Proc. 32nd
+ *     VLDB Conference: 595--606.
+ *
+ * Deletions can shrink the sample, so once it risks falling below a
+ * given lower bound it is re-drawn from the table using one of the
+ * sequential samplers.  With Algorithm D this costs O(M) for a sample
+ * of at most M records, so the cost of maintenance follows the churn
+ * of the table rather than its size.
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (C) 2010 Joseph Rushton Wakeling
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdint.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_sampling.h>
+
+/* Records are identified by size_t keys, and the sample is kept as a
+   compact array of keys.  To find whether a deleted key is in the sample
+   we keep an open-addressing (linear probing) hash index from keys to
+   their position in the sample array; index entries hold the position
+   plus one, so that 0 marks an empty slot.  The index has at least twice
+   as many slots as the maximum sample size.
+
+   c1 and c2 are the random pairing counters: the number of deletions
+   that removed a record from the sample, and the number that did not,
+   which have yet to be paired with a subsequent insertion. */
+typedef struct
+  {
+    size_t c1;
+    size_t c2;
+    size_t mask;
+    size_t *index;
+  }
+backing_state_t;
+
+static inline size_t
+backing_hash (size_t key)
+{
+  uint64_t z = key;
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+/* Returns the index slot holding key, or the empty slot where it would
+   be inserted. */
+static size_t
+backing_find (const gsl_backing_sample * b, size_t key)
+{
+  const backing_state_t *state = b->state;
+  size_t h = backing_hash(key) & state->mask;
+
+  while (state->index[h] != 0 && b->sample[state->index[h] - 1] != key)
+    h = (h + 1) & state->mask;
+
+  return h;
+}
+
+/* Empties index slot h, shifting back any later entries in the same
+   probe sequence so that lookups never need tombstones. */
+static void
+backing_unindex (const gsl_backing_sample * b, size_t h)
+{
+  const backing_state_t *state = b->state;
+  size_t home, j = h;
+
+  while (1)
+    {
+      j = (j + 1) & state->mask;
+
+      if (state->index[j] == 0)
+        break;
+
+      home = backing_hash(b->sample[state->index[j] - 1]) & state->mask;
+
+      if (((j - home) & state->mask) >= ((j - h) & state->mask))
+        {
+          state->index[h] = state->index[j];
+          h = j;
+        }
+    }
+
+  state->index[h] = 0;
+}
+
+static void
+backing_add (gsl_backing_sample * b, size_t key)
+{
+  backing_state_t *state = b->state;
+
+  b->sample[b->size] = key;
+  state->index[backing_find(b, key)] = ++(b->size);
+}
+
+/* Removes the key held in index slot h from the sample, moving the last
+   key in the sample array into the hole it leaves. */
+static void
+backing_remove (gsl_backing_sample * b, size_t h)
+{
+  backing_state_t *state = b->state;
+  size_t pos = state->index[h] - 1, last = b->size - 1;
+
+  backing_unindex(b, h);
+
+  if (pos != last)
+    {
+      state->index[backing_find(b, b->sample[last])] = pos + 1;
+      b->sample[pos] = b->sample[last];
+    }
+
+  --(b->size);
+}
+
+/* Overwrites the key at position pos in the sample with a new key. */
+static void
+backing_replace (gsl_backing_sample * b, size_t pos, size_t key)
+{
+  backing_state_t *state = b->state;
+
+  backing_unindex(b, backing_find(b, b->sample[pos]));
+  b->sample[pos] = key;
+  state->index[backing_find(b, key)] = pos + 1;
+}
+
+gsl_backing_sample *
+gsl_backing_sample_alloc(size_t max_size, size_t min_size)
+{
+  gsl_backing_sample *b;
+  backing_state_t *state;
+  size_t slots = 2;
+
+  if (max_size == 0 || min_size > max_size)
+    {
+      GSL_ERROR_VAL ("need 0 < max_size and min_size <= max_size",
+                     GSL_EINVAL, 0);
+    }
+
+  while (slots < 2 * max_size)
+    slots *= 2;
+
+  b = malloc(sizeof(gsl_backing_sample));
+
+  if (b == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for backing sample struct",
+                     GSL_ENOMEM, 0);
+    }
+
+  b->sample = malloc(max_size * sizeof(size_t));
+
+  if (b->sample == 0)
+    {
+      free(b);
+
+      GSL_ERROR_VAL ("failed to allocate space for sample",
+                     GSL_ENOMEM, 0);
+    }
+
+  b->state = state = malloc(sizeof(backing_state_t));
+
+  if (state == 0)
+    {
+      free(b->sample);
+      free(b);
+
+      GSL_ERROR_VAL ("failed to allocate space for backing sample state",
+                     GSL_ENOMEM, 0);
+    }
+
+  state->index = calloc(slots, sizeof(size_t));
+
+  if (state->index == 0)
+    {
+      free(state);
+      free(b->sample);
+      free(b);
+
+      GSL_ERROR_VAL ("failed to allocate space for sample index",
+                     GSL_ENOMEM, 0);
+    }
+
+  state->mask = slots - 1;
+  state->c1 = state->c2 = 0;
+
+  b->max_size = max_size;
+  b->min_size = min_size;
+  b->size = b->population = 0;
+
+  return b;
+}
+
+void
+gsl_backing_sample_free(gsl_backing_sample * b)
+{
+  backing_state_t *state;
+
+  RETURN_IF_NULL(b);
+  state = b->state;
+  free(state->index);
+  free(state);
+  free(b->sample);
+  free(b);
+}
+
+/* Draws a fresh sample of min(max_size, n) keys from the n keys of the
+   table using the sampler s, and rebuilds the index.  Running time is
+   that of gsl_sampler_choose plus O(max_size). */
+int
+gsl_backing_sample_init(gsl_backing_sample * b, const gsl_sampler * s,
+                        const gsl_rng * r, size_t * keys, size_t n)
+{
+  backing_state_t *state = b->state;
+  size_t i, k = (n < b->max_size) ? n : b->max_size;
+  int status;
+
+  status = gsl_sampler_choose(s, r, b->sample, k, keys, n, sizeof(size_t));
+
+  if (status != GSL_SUCCESS)
+    return status;
+
+  for(i=0;i<=state->mask;++i)
+    state->index[i] = 0;
+
+  b->size = 0;
+
+  for(i=0;i<k;++i)
+    backing_add(b, b->sample[i]);
+
+  b->population = n;
+  state->c1 = state->c2 = 0;
+
+  return GSL_SUCCESS;
+}
+
+/* Notifies the sample that key has been inserted into the table.  If no
+   deletions are awaiting compensation this is a step of reservoir
+   sampling; otherwise the insertion is paired with an earlier deletion,
+   and the new key enters the sample with probability c1/(c1 + c2).
+
+   Keys must be unique: key must not already be in the table.  This is
+   not checked, and inserting a key twice can leave it in the sample
+   twice. */
+int
+gsl_backing_sample_insert(gsl_backing_sample * b, const gsl_rng * r,
+                          size_t key)
+{
+  backing_state_t *state = b->state;
+  size_t d = state->c1 + state->c2;
+
+  ++(b->population);
+
+  if (d == 0)
+    {
+      if (b->size < b->max_size)
+        {
+          backing_add(b, key);
+        }
+      else if (gsl_rng_uniform(r) * b->population < b->max_size)
+        {
+          backing_replace(b, gsl_rng_uniform_int(r, b->size), key);
+        }
+    }
+  else if (gsl_rng_uniform(r) * d < state->c1)
+    {
+      backing_add(b, key);
+      --(state->c1);
+    }
+  else
+    {
+      --(state->c2);
+    }
+
+  return GSL_SUCCESS;
+}
+
+/* Notifies the sample that key has been deleted from the table.
+
+   key must be in the table (i.e. inserted, or passed to init or refresh,
+   and not since deleted).  This is not checked: a key that is not in the
+   sample is counted as an uncompensated deletion from the rest of the
+   table, so deleting a key that was never there biases the pairing of
+   later insertions. */
+int
+gsl_backing_sample_delete(gsl_backing_sample * b, size_t key)
+{
+  backing_state_t *state = b->state;
+  size_t h;
+
+  if (b->population == 0)
+    {
+      GSL_ERROR ("Cannot delete a record from an empty table.", GSL_EINVAL) ;
+    }
+
+  --(b->population);
+
+  h = backing_find(b, key);
+
+  if (state->index[h] != 0)
+    {
+      backing_remove(b, h);
+      ++(state->c1);
+    }
+  else
+    {
+      ++(state->c2);
+    }
+
+  return GSL_SUCCESS;
+}
+
+/* Returns 1 if the sample may have shrunk below min_size (or below the
+   size of the table, if that is smaller), and 0 otherwise.
+
+   We cannot simply test the current sample size: whether a deletion
+   shrinks the sample depends on which records the sample holds, so a
+   refresh triggered by the sample size would bias the samples that
+   survive without one.  Instead we test size - c2.  Under random pairing,
+   while c1 + c2 > 0 every operation either moves a record between the
+   sample and c1 or changes only c2, so size + c1 stays fixed at the value
+   it had when c1 + c2 last became non-zero.  Hence size - c2 equals
+   (size + c1) - (c1 + c2), and both terms of that depend only on the
+   sequence of inserts and deletes, not on the random choices made.
+   Since c1 <= c1 + c2, the sample size is never below it, so refreshing
+   when it falls below the bound keeps the sample uniform while still
+   guaranteeing that it never drops below min_size. */
+int
+gsl_backing_sample_needs_refresh(const gsl_backing_sample * b)
+{
+  const backing_state_t *state = b->state;
+  size_t bound = (b->population < b->min_size) ? b->population : b->min_size;
+
+  return b->size < bound + state->c2;
+}
+
+/* Re-draws the sample from the n keys of the table, but only if it may
+   have shrunk below its lower bound; otherwise does nothing.  The caller need
+   only assemble the keys array when gsl_backing_sample_needs_refresh
+   says so. */
+int
+gsl_backing_sample_refresh(gsl_backing_sample * b, const gsl_sampler * s,
+                           const gsl_rng * r, size_t * keys, size_t n)
+{
+  if (!gsl_backing_sample_needs_refresh(b))
+    return GSL_SUCCESS;
+
+  return gsl_backing_sample_init(b, s, r, keys, n);
+}
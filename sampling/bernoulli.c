@@ -0,0 +1,200 @@
+/* sampling/bernoulli.c
+ *
+ * ---------------------------------------------------------------------
+ * Provides Bernoulli sampling, in which each record is selected
+ * independently with fixed probability p, so that the size of the
+ * sample is itself random with mean pN.
+ *
+ * Rather than generating one variate per record, the sampler follows
+ * the skip-based model of the fixed-size samplers and generates the
+ * number of records to skip between successive selections directly.
+ * These skips are geometrically distributed, so the method requires
+ * only about pN random variates and runs in O(pN) time.
+ *
+ * It is a separate type rather than another gsl_sampling_algorithm
+ * because gsl_sampler_skip and gsl_sampler_choose rely on a fixed
+ * sample size: each skip decrements sample->remaining, which has no
+ * meaning when the number of records to be selected is not known in
+ * advance.
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (C) 2010 Joseph Rushton Wakeling
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_sampling.h>
+
+gsl_bernoulli_sampler *
+gsl_bernoulli_sampler_alloc(void)
+{
+  gsl_bernoulli_sampler *b = malloc(sizeof(gsl_bernoulli_sampler));
+
+  if (b == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for Bernoulli sampler struct",
+                     GSL_ENOMEM, 0);
+    }
+
+  b->records = malloc(sizeof(gsl_sampling_records));
+
+  if (b->records == 0)
+    {
+      free(b);
+
+      GSL_ERROR_VAL ("failed to allocate space for records",
+                     GSL_ENOMEM, 0);
+    }
+
+  b->p = 0;
+  b->log_q_inverse = 0;
+  b->records->remaining = b->records->total = 0;
+
+  return b;
+}
+
+void
+gsl_bernoulli_sampler_free(gsl_bernoulli_sampler * b)
+{
+  RETURN_IF_NULL(b);
+  free(b->records);
+  free(b);
+}
+
+/* The skip function needs only 1/log(1-p), which we calculate once here
+   rather than once per skip.  Note that the extreme cases take care of
+   themselves: p == 0 gives log_q_inverse == -inf and hence an infinite
+   skip, while p == 1 gives log_q_inverse == -0 and hence a skip of 0. */
+int
+gsl_bernoulli_sampler_init(gsl_bernoulli_sampler * b, double p, size_t records)
+{
+  if ( !(p >= 0 && p <= 1) )
+    {
+      GSL_ERROR ("Selection probability must lie in the range [0, 1].",
+                 GSL_EDOM) ;
+    }
+
+  b->p = p;
+  b->log_q_inverse = 1.0 / log1p(-p);
+  b->records->remaining = b->records->total = records;
+
+  return GSL_SUCCESS;
+}
+
+/* The number of records skipped before the next selected record is
+   geometrically distributed, P(S = s) = (1-p)^s p.  We generate it by
+   inversion, S = floor(log(U) / log(1-p)), using gsl_rng_uniform_pos so
+   that log(U) is always finite.
+
+   The comparison is made in floating point before converting to size_t,
+   so that very large (or infinite) skips safely mark the end of the
+   records rather than overflowing.  Returns 0 and sets the remaining
+   records to 0 if no further record is selected, otherwise returns 1.
+ */
+static inline int
+bernoulli_select(const gsl_bernoulli_sampler * b, const gsl_rng * r,
+                 size_t * const current_record, size_t * const selected)
+{
+  double X = floor(log(gsl_rng_uniform_pos(r)) * b->log_q_inverse);
+
+  if (X >= b->records->remaining)
+    {
+      *current_record += b->records->remaining;
+      b->records->remaining = 0;
+      return 0;
+    }
+  else
+    {
+      size_t S = X;
+
+      *current_record += S;
+      b->records->remaining -= (S+1);
+      *selected = (*current_record)++;
+      return 1;
+    }
+}
+
+/* Fills index with up to m selected record indices, continuing on from
+   *current_record in the same manner as gsl_sampler_select.  Returns the
+   number of indices written, which is less than m only if the records
+   have been exhausted.  Generating the skips in batches like this saves
+   the per-record function call overhead when the caller wants to process
+   the selected indices in bulk. */
+size_t
+gsl_bernoulli_sampler_fill(const gsl_bernoulli_sampler * b, const gsl_rng * r,
+                           size_t * const current_record, size_t * index,
+                           size_t m)
+{
+  size_t i;
+
+  for(i=0;i<m && b->records->remaining > 0;++i)
+    {
+      if (!bernoulli_select(b, r, current_record, &index[i]))
+        break;
+    }
+
+  return i;
+}
+
+#define BERNOULLI_CHOOSE_BATCH 64
+
+/* Bernoulli counterpart of gsl_sampler_choose: each of the n records in
+   src is copied to dest independently with the probability p given to
+   gsl_bernoulli_sampler_init, in order.  The number of records copied is
+   written to *k.
+
+   Since the sample size is random, the caller must supply the capacity
+   k_max of dest; if more than k_max records are selected the sample is
+   truncated at k_max and GSL_EBADLEN is returned.  Selected indices are
+   generated in small batches with gsl_bernoulli_sampler_fill, so the
+   whole selection runs in O(pn) time.  Records are copied with memcpy,
+   as the copy() used by gsl_sampler_choose is private to sampling.c.
+ */
+int
+gsl_bernoulli_sampler_choose(const gsl_bernoulli_sampler * b, const gsl_rng * r,
+                             void * dest, size_t k_max, size_t * k,
+                             void * src, size_t n, size_t size)
+{
+  size_t selected[BERNOULLI_CHOOSE_BATCH];
+  size_t i, m, current_record = 0;
+
+  *k = 0;
+  b->records->remaining = b->records->total = n;
+
+  do
+    {
+      m = gsl_bernoulli_sampler_fill(b, r, &current_record, selected,
+                                     BERNOULLI_CHOOSE_BATCH);
+
+      for(i=0;i<m;++i)
+        {
+          if (*k == k_max)
+            {
+              GSL_ERROR ("dest is too small to hold the sample",
+                         GSL_EBADLEN);
+            }
+
+          memcpy((char *) dest + size * (*k)++,
+                 (char *) src + size * selected[i], size);
+        }
+    }
+  while (m == BERNOULLI_CHOOSE_BATCH);
+
+  return GSL_SUCCESS;
+}
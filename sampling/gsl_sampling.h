@@ -66,6 +66,34 @@ typedef struct
   }
 gsl_sampler;
 
+typedef struct
+  {
+    double p;
+    double log_q_inverse;
+    gsl_sampling_records *records;
+  }
+gsl_bernoulli_sampler;
+
+typedef struct
+  {
+    size_t k;
+    size_t size;
+    size_t threads;
+    void *state;
+  }
+gsl_reservoir_sampler;
+
+typedef struct
+  {
+    size_t max_size;
+    size_t min_size;
+    size_t size;
+    size_t population;
+    size_t *sample;
+    void *state;
+  }
+gsl_backing_sample;
+
 
 GSL_VAR const gsl_sampling_algorithm *gsl_sampler_vitter_a;
 GSL_VAR const gsl_sampling_algorithm *gsl_sampler_vitter_d;
@@ -86,6 +114,78 @@ int
 gsl_sampler_choose(const gsl_sampler * s, const gsl_rng * r, void * dest,
                    size_t k, void * src, size_t n, size_t size);
 
+int
+gsl_sampler_choose_unordered(const gsl_sampler * s, const gsl_rng * r,
+                             void * dest, size_t k, void * src, size_t n,
+                             size_t size);
+
+int
+gsl_sampler_choose_multi(const gsl_sampler * const * s, size_t R,
+                         const gsl_rng * r, void ** dest, size_t k,
+                         void * src, size_t n, size_t size);
+
+
+gsl_bernoulli_sampler *
+gsl_bernoulli_sampler_alloc(void);
+
+void
+gsl_bernoulli_sampler_free(gsl_bernoulli_sampler * b);
+
+int
+gsl_bernoulli_sampler_init(gsl_bernoulli_sampler * b, double p, size_t records);
+
+size_t
+gsl_bernoulli_sampler_fill(const gsl_bernoulli_sampler * b, const gsl_rng * r,
+                           size_t * const current_record, size_t * index,
+                           size_t m);
+
+int
+gsl_bernoulli_sampler_choose(const gsl_bernoulli_sampler * b, const gsl_rng * r,
+                             void * dest, size_t k_max, size_t * k,
+                             void * src, size_t n, size_t size);
+
+
+gsl_reservoir_sampler *
+gsl_reservoir_sampler_alloc(size_t k, size_t size, size_t threads);
+
+void
+gsl_reservoir_sampler_free(gsl_reservoir_sampler * s);
+
+int
+gsl_reservoir_sampler_init(const gsl_reservoir_sampler * s);
+
+int
+gsl_reservoir_sampler_push(const gsl_reservoir_sampler * s, size_t thread,
+                           const gsl_rng * r, const void * item);
+
+size_t
+gsl_reservoir_sampler_gather(const gsl_reservoir_sampler * s, void * dest);
+
+
+gsl_backing_sample *
+gsl_backing_sample_alloc(size_t max_size, size_t min_size);
+
+void
+gsl_backing_sample_free(gsl_backing_sample * b);
+
+int
+gsl_backing_sample_init(gsl_backing_sample * b, const gsl_sampler * s,
+                        const gsl_rng * r, size_t * keys, size_t n);
+
+int
+gsl_backing_sample_insert(gsl_backing_sample * b, const gsl_rng * r,
+                          size_t key);
+
+int
+gsl_backing_sample_delete(gsl_backing_sample * b, size_t key);
+
+int
+gsl_backing_sample_needs_refresh(const gsl_backing_sample * b);
+
+int
+gsl_backing_sample_refresh(gsl_backing_sample * b, const gsl_sampler * s,
+                           const gsl_rng * r, size_t * keys, size_t n);
+
 
 #ifdef HAVE_INLINE
 
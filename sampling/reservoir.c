@@ -0,0 +1,461 @@
+/* sampling/reservoir.c
+ *
+ * ---------------------------------------------------------------------
+ * Provides a reservoir sampler that can be fed concurrently by several
+ * threads, each seeing its own part of a single stream of records, and
+ * which yields a uniform sample of k records from everything pushed by
+ * all of the threads together.
+ *
+ * Each record is (implicitly) given an independent uniform random
+ * priority, and the sample consists of the k records with the smallest
+ * priorities.  Each thread keeps its own reservoir of the k smallest
+ * priorities it has seen, so the global sample is always contained in
+ * the union of the thread reservoirs and can be merged out at the end.
+ *
+ * The largest priority in a full reservoir is an upper bound on the
+ * priority of any record that can still make it into the global sample.
+ * Threads publish these bounds to a single shared threshold with an
+ * atomic compare-and-swap, and use the smallest bound known to them to
+ * skip over records whose priority would be too large: the number of
+ * records to skip before the next candidate is geometrically
+ * distributed, as in the Bernoulli sampler, so only candidate records
+ * cost any random variates.  No locks are taken at any point.
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (C) 2010 Joseph Rushton Wakeling
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_sampling.h>
+
+/* Assumed size of a cache line.  Blocks of memory written by one thread
+   are aligned to, and padded out to a multiple of, this size so that they
+   share no cache line with memory written by any other thread. */
+#define RESERVOIR_CACHE_LINE 64
+
+/* Per-thread state.  The reservoir is a max-heap of slot numbers keyed on
+   the priority of the record held in each slot, so that heap operations
+   never have to move the (arbitrarily large) records themselves.
+
+   Each thread's struct and its three arrays live together in a single
+   block allocated with reservoir_aligned_alloc, so that the fields
+   written on every push (count, skip, threshold) and the arrays written
+   on every candidate are on cache lines used by that thread alone. */
+typedef struct
+  {
+    size_t count;
+    size_t skip;
+    double threshold;
+    size_t *heap;
+    double *priority;
+    char *items;
+  }
+reservoir_local_t;
+
+/* The shared threshold is a double in [0, 1], stored by its bit pattern
+   so that it can be updated with integer atomic operations.  For
+   non-negative doubles the bit patterns sort in the same order as the
+   values themselves, so an atomic minimum on the integers is an atomic
+   minimum on the priorities.  It is padded out to a cache line of its
+   own, so that publishing it does not disturb the (read-only) pointers
+   to the thread states. */
+typedef struct
+  {
+    uint64_t threshold;
+    char pad[RESERVOIR_CACHE_LINE - sizeof(uint64_t)];
+    reservoir_local_t **local;
+  }
+reservoir_state_t;
+
+static inline uint64_t
+threshold_to_bits (double t)
+{
+  uint64_t bits;
+  memcpy(&bits, &t, sizeof(bits));
+  return bits;
+}
+
+static inline double
+threshold_from_bits (uint64_t bits)
+{
+  double t;
+  memcpy(&t, &bits, sizeof(t));
+  return t;
+}
+
+/* Allocates n bytes aligned to a cache line and padded out to a whole
+   number of cache lines.  The pointer returned by malloc is stashed just
+   before the aligned block, for reservoir_aligned_free. */
+static void *
+reservoir_aligned_alloc (size_t n)
+{
+  char *raw, *aligned;
+
+  n = (n + RESERVOIR_CACHE_LINE - 1) / RESERVOIR_CACHE_LINE;
+  n *= RESERVOIR_CACHE_LINE;
+  raw = malloc(n + RESERVOIR_CACHE_LINE - 1 + sizeof(void *));
+
+  if (raw == 0)
+    return 0;
+
+  aligned = raw + sizeof(void *);
+  aligned += (RESERVOIR_CACHE_LINE - (uintptr_t) aligned % RESERVOIR_CACHE_LINE)
+               % RESERVOIR_CACHE_LINE;
+  memcpy(aligned - sizeof(void *), &raw, sizeof(void *));
+
+  return aligned;
+}
+
+static void
+reservoir_aligned_free (void * aligned)
+{
+  void *raw;
+
+  RETURN_IF_NULL(aligned);
+  memcpy(&raw, (char *) aligned - sizeof(void *), sizeof(void *));
+  free(raw);
+}
+
+/* Lays out the struct, priorities, heap and records in that order in one
+   block; the struct and both arrays are multiples of 8 bytes in size, so
+   every member stays suitably aligned. */
+static reservoir_local_t *
+reservoir_local_alloc (size_t k, size_t size)
+{
+  reservoir_local_t *local;
+
+  local = reservoir_aligned_alloc(sizeof(reservoir_local_t)
+                                  + k * (sizeof(double) + sizeof(size_t) + size));
+
+  if (local == 0)
+    return 0;
+
+  local->priority = (double *) (local + 1);
+  local->heap = (size_t *) (local->priority + k);
+  local->items = (char *) (local->heap + k);
+
+  return local;
+}
+
+gsl_reservoir_sampler *
+gsl_reservoir_sampler_alloc(size_t k, size_t size, size_t threads)
+{
+  size_t i;
+  gsl_reservoir_sampler *s;
+  reservoir_state_t *state;
+
+  if (k == 0 || size == 0 || threads == 0)
+    {
+      GSL_ERROR_VAL ("sample size, record size and number of threads must be positive",
+                     GSL_EINVAL, 0);
+    }
+
+  s = malloc(sizeof(gsl_reservoir_sampler));
+
+  if (s == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for reservoir sampler struct",
+                     GSL_ENOMEM, 0);
+    }
+
+  s->state = state = reservoir_aligned_alloc(sizeof(reservoir_state_t));
+
+  if (state == 0)
+    {
+      free(s);
+
+      GSL_ERROR_VAL ("failed to allocate space for reservoir sampler state",
+                     GSL_ENOMEM, 0);
+    }
+
+  state->local = calloc(threads, sizeof(reservoir_local_t *));
+
+  if (state->local == 0)
+    {
+      reservoir_aligned_free(state);
+      free(s);
+
+      GSL_ERROR_VAL ("failed to allocate space for thread reservoirs",
+                     GSL_ENOMEM, 0);
+    }
+
+  s->k = k;
+  s->size = size;
+  s->threads = threads;
+
+  for(i=0;i<threads;++i)
+    {
+      state->local[i] = reservoir_local_alloc(k, size);
+
+      if (state->local[i] == 0)
+        {
+          gsl_reservoir_sampler_free(s);
+
+          GSL_ERROR_VAL ("failed to allocate space for thread reservoirs",
+                         GSL_ENOMEM, 0);
+        }
+    }
+
+  gsl_reservoir_sampler_init(s);
+
+  return s;
+}
+
+void
+gsl_reservoir_sampler_free(gsl_reservoir_sampler * s)
+{
+  size_t i;
+  reservoir_state_t *state;
+
+  RETURN_IF_NULL(s);
+  state = s->state;
+
+  for(i=0;i<s->threads;++i)
+    reservoir_aligned_free(state->local[i]);
+
+  free(state->local);
+  reservoir_aligned_free(state);
+  free(s);
+}
+
+/* Empties all the reservoirs.  This must not be called while any thread
+   is pushing records. */
+int
+gsl_reservoir_sampler_init(const gsl_reservoir_sampler * s)
+{
+  size_t i;
+  reservoir_state_t *state = s->state;
+
+  state->threshold = threshold_to_bits(1.0);
+
+  for(i=0;i<s->threads;++i)
+    {
+      state->local[i]->count = 0;
+      state->local[i]->skip = 0;
+      state->local[i]->threshold = 1.0;
+    }
+
+  return GSL_SUCCESS;
+}
+
+static void
+reservoir_sift_down (reservoir_local_t * local, size_t len)
+{
+  size_t i = 0, child, top = local->heap[0];
+
+  while ((child = 2*i + 1) < len)
+    {
+      if (child + 1 < len
+          && local->priority[local->heap[child+1]] > local->priority[local->heap[child]])
+        ++child;
+
+      if (local->priority[local->heap[child]] <= local->priority[top])
+        break;
+
+      local->heap[i] = local->heap[child];
+      i = child;
+    }
+
+  local->heap[i] = top;
+}
+
+static void
+reservoir_sift_up (reservoir_local_t * local, size_t i)
+{
+  size_t parent, bottom = local->heap[i];
+
+  while (i > 0)
+    {
+      parent = (i - 1)/2;
+
+      if (local->priority[local->heap[parent]] >= local->priority[bottom])
+        break;
+
+      local->heap[i] = local->heap[parent];
+      i = parent;
+    }
+
+  local->heap[i] = bottom;
+}
+
+/* Lowers the shared threshold to t, unless another thread has already
+   lowered it further. */
+static void
+reservoir_publish (reservoir_state_t * state, double t)
+{
+  uint64_t desired = threshold_to_bits(t);
+  uint64_t current = __atomic_load_n(&state->threshold, __ATOMIC_RELAXED);
+
+  while (desired < current
+         && !__atomic_compare_exchange_n(&state->threshold, &current, desired,
+                                         1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* Pushes one record from the stream into the sampler on behalf of the
+   given thread.  Each thread must use its own thread number, in the
+   range [0, threads), and its own random number generator; different
+   threads may call this function concurrently.
+
+   Records between candidates cost only a decrement.  When a candidate is
+   reached it is given a priority uniformly distributed below the
+   threshold that its skip was drawn against (which is exactly the
+   conditional distribution of its priority given that the skipped
+   records were all above the threshold), and a new skip is drawn
+   against the smallest threshold now known to the thread.
+ */
+int
+gsl_reservoir_sampler_push(const gsl_reservoir_sampler * s, size_t thread,
+                           const gsl_rng * r, const void * item)
+{
+  reservoir_state_t *state = s->state;
+  reservoir_local_t *local;
+  double u, t, shared, X;
+  size_t slot;
+
+  if (thread >= s->threads)
+    {
+      GSL_ERROR ("thread number is out of range", GSL_EINVAL) ;
+    }
+
+  local = state->local[thread];
+
+  if (local->skip > 0)
+    {
+      --(local->skip);
+      return GSL_SUCCESS;
+    }
+
+  u = local->threshold * gsl_rng_uniform_pos(r);
+  shared = threshold_from_bits(__atomic_load_n(&state->threshold, __ATOMIC_RELAXED));
+
+  if (u < shared)
+    {
+      if (local->count < s->k)
+        {
+          slot = local->count;
+          local->heap[local->count] = slot;
+          local->priority[slot] = u;
+          memcpy(local->items + slot * s->size, item, s->size);
+          reservoir_sift_up(local, local->count++);
+        }
+      else
+        {
+          slot = local->heap[0];
+          local->priority[slot] = u;
+          memcpy(local->items + slot * s->size, item, s->size);
+          reservoir_sift_down(local, s->k);
+        }
+
+      if (local->count == s->k)
+        {
+          t = local->priority[local->heap[0]];
+
+          if (t < shared)
+            {
+              reservoir_publish(state, t);
+              shared = t;
+            }
+        }
+    }
+
+  local->threshold = t = shared;
+
+  if (t >= 1.0)
+    {
+      local->skip = 0;
+    }
+  else
+    {
+      X = floor(log(gsl_rng_uniform_pos(r)) / log1p(-t));
+      local->skip = (X >= (double) SIZE_MAX) ? SIZE_MAX : (size_t) X;
+    }
+
+  return GSL_SUCCESS;
+}
+
+typedef struct
+  {
+    double priority;
+    const char *item;
+  }
+reservoir_candidate_t;
+
+static int
+reservoir_candidate_cmp (const void * a, const void * b)
+{
+  double pa = ((const reservoir_candidate_t *) a)->priority;
+  double pb = ((const reservoir_candidate_t *) b)->priority;
+
+  return (pa > pb) - (pa < pb);
+}
+
+/* Merges the thread reservoirs, writing to dest the k records with the
+   smallest priorities among everything pushed since the last call to
+   gsl_reservoir_sampler_init (or all of them, if fewer than k records
+   were pushed).  Returns the number of records written.  The records are
+   written in order of priority, which is a uniformly random order.
+
+   This must only be called once all threads have finished pushing. */
+size_t
+gsl_reservoir_sampler_gather(const gsl_reservoir_sampler * s, void * dest)
+{
+  reservoir_state_t *state = s->state;
+  reservoir_candidate_t *candidates;
+  size_t i, j, n = 0;
+
+  for(i=0;i<s->threads;++i)
+    n += state->local[i]->count;
+
+  if (n == 0)
+    return 0;
+
+  candidates = malloc(n * sizeof(reservoir_candidate_t));
+
+  if (candidates == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for merging reservoirs",
+                     GSL_ENOMEM, 0);
+    }
+
+  for(i=0, n=0;i<s->threads;++i)
+    {
+      reservoir_local_t *local = state->local[i];
+
+      for(j=0;j<local->count;++j, ++n)
+        {
+          candidates[n].priority = local->priority[j];
+          candidates[n].item = local->items + j * s->size;
+        }
+    }
+
+  qsort(candidates, n, sizeof(reservoir_candidate_t), &reservoir_candidate_cmp);
+
+  if (n > s->k)
+    n = s->k;
+
+  for(i=0;i<n;++i)
+    memcpy((char *) dest + i * s->size, candidates[i].item, s->size);
+
+  free(candidates);
+
+  return n;
+}
@@ -148,3 +148,146 @@ gsl_sampler_choose(const gsl_sampler * s, const gsl_rng * r, void * dest,
 
   return GSL_SUCCESS;
 }
+
+/* As gsl_sampler_choose, but the k selected records are written to dest
+   in uniformly random order rather than in the order in which they
+   appear in src.
+
+   Rather than following the ordered selection with a separate call to
+   gsl_ran_shuffle, each newly-selected record is placed using one step
+   of the "inside-out" Fisher-Yates shuffle: the i'th record selected is
+   written to a uniformly-chosen position j in [0, i], with whatever was
+   previously at position j moved to position i.  This costs one extra
+   random variate and at most two element copies per selected record
+   (2k copies in total), and with Algorithm D the whole selection runs
+   in O(k) time and requires no extra memory.
+ */
+int
+gsl_sampler_choose_unordered(const gsl_sampler * s, const gsl_rng * r,
+                             void * dest, size_t k, void * src, size_t n,
+                             size_t size)
+{
+  size_t i, j, current_record = 0, selected_record;
+
+  if ( k > n )
+    {
+      GSL_ERROR ("k is greater than n, cannot sample more than n items",
+                 GSL_EINVAL) ;
+    }
+
+  gsl_sampler_init(s, r, k, n);
+
+  for(i=0;i<k;++i)
+    {
+      selected_record = gsl_sampler_select(s, r, &current_record);
+      j = gsl_rng_uniform_int(r, i+1);
+
+      if (j != i)
+        copy(dest, i, dest, j, size);
+
+      copy(dest, j, src, selected_record, size);
+    }
+
+  return GSL_SUCCESS;
+}
+
+/* Helper for gsl_sampler_choose_multi: restores the min-heap property
+   of heap[0..len-1], keyed on next[heap[...]], from position i downwards.
+ */
+static void
+heap_sift_down (size_t * heap, size_t len, size_t i, const size_t * next)
+{
+  size_t child, top = heap[i];
+
+  while ((child = 2*i + 1) < len)
+    {
+      if (child + 1 < len && next[heap[child+1]] < next[heap[child]])
+        ++child;
+
+      if (next[heap[child]] >= next[top])
+        break;
+
+      heap[i] = heap[child];
+      i = child;
+    }
+
+  heap[i] = top;
+}
+
+/* Draws R independent samples of k records each from src in a single
+   pass, writing the i'th sample to dest[i] in the order in which the
+   records appear in src.  Each of the R samplers must be distinct, as
+   each keeps its own state.
+
+   The samplers' skip streams are merged through a min-heap keyed on the
+   next record each one will select, so that src is walked once from
+   start to finish and each record is dispatched to every sample that
+   has selected it.  Memory reads therefore scale with a single pass over
+   the union of the samples rather than R separate passes, at the cost of
+   O(log R) heap maintenance per selected record.
+ */
+int
+gsl_sampler_choose_multi(const gsl_sampler * const * s, size_t R,
+                         const gsl_rng * r, void ** dest, size_t k,
+                         void * src, size_t n, size_t size)
+{
+  size_t i, len, record;
+  size_t *heap, *next, *current_record, *count;
+
+  if ( k > n )
+    {
+      GSL_ERROR ("k is greater than n, cannot sample more than n items",
+                 GSL_EINVAL) ;
+    }
+
+  if ( R == 0 || k == 0 )
+    return GSL_SUCCESS;
+
+  heap = malloc(4 * R * sizeof(size_t));
+
+  if (heap == 0)
+    {
+      GSL_ERROR ("failed to allocate space for sampler heap", GSL_ENOMEM);
+    }
+
+  next = heap + R;
+  current_record = next + R;
+  count = current_record + R;
+
+  for(i=0;i<R;++i)
+    {
+      gsl_sampler_init(s[i], r, k, n);
+      current_record[i] = 0;
+      count[i] = 0;
+      next[i] = gsl_sampler_select(s[i], r, &current_record[i]);
+      heap[i] = i;
+    }
+
+  len = R;
+
+  for(i=len/2;i-->0;)
+    heap_sift_down(heap, len, i, next);
+
+  while (len > 0)
+    {
+      record = next[heap[0]];
+
+      do
+        {
+          i = heap[0];
+          copy(dest[i], count[i]++, src, record, size);
+
+          if (s[i]->sample->remaining > 0)
+            next[i] = gsl_sampler_select(s[i], r, &current_record[i]);
+          else
+            heap[0] = heap[--len];
+
+          heap_sift_down(heap, len, 0, next);
+        }
+      while (len > 0 && next[heap[0]] == record);
+    }
+
+  free(heap);
+
+  return GSL_SUCCESS;
+}